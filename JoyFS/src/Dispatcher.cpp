@@ -0,0 +1,46 @@
+#include "Dispatcher.h"
+#include "Sim.h"
+
+Dispatcher::Dispatcher(const std::map<int, Joystick>& joysticks)
+{
+    for (const auto& [device, joystick] : joysticks) add(device, joystick);
+}
+
+void Dispatcher::add(int device, const Joystick& joystick)
+{
+    if (device < 0) return;
+
+    if (static_cast<size_t>(device) >= buttons_.size()) buttons_.resize(device + 1);
+
+    auto& buttons = buttons_[device];
+    buttons.clear();
+    for (const auto& [index, button] : joystick.buttons)
+    {
+        if (index < 0) continue;
+        if (static_cast<size_t>(index) >= buttons.size()) buttons.resize(index + 1);
+        buttons[index] = button;
+    }
+}
+
+bool Dispatcher::button(int device, int index, bool pressed, Sim& sim) const
+{
+    if (device < 0 || static_cast<size_t>(device) >= buttons_.size()) return false;
+
+    const auto& buttons = buttons_[device];
+    if (index < 0 || static_cast<size_t>(index) >= buttons.size() || !buttons[index]) return false;
+
+    const Button& b = *buttons[index];
+
+    if (!pressed)
+    {
+        if (b.releaseValue) sim.set(b.offset, b.size, *b.releaseValue);
+        return true;
+    }
+
+    if (b.operation == Operation::Delta)
+        sim.add(b.offset, b.size, b.value);
+    else
+        sim.set(b.offset, b.size, b.value);
+
+    return true;
+}
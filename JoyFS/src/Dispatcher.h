@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Mapping.h"
+
+#include <map>
+#include <optional>
+#include <vector>
+
+class Sim;
+
+// Button bindings compiled into flat tables indexed by device number (as in
+// Settings.json) and button index, so the event path does no map searches.
+// Input backends translate their own device handles to device numbers.
+class Dispatcher
+{
+public:
+    Dispatcher() = default;
+    explicit Dispatcher(const std::map<int, Joystick>& joysticks);
+
+    void add(int device, const Joystick& joystick);
+
+    // runs the bound operation, returns false if the button has no binding
+    bool button(int device, int index, bool pressed, Sim& sim) const;
+
+private:
+    std::vector<std::vector<std::optional<Button>>> buttons_;
+};
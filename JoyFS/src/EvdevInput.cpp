@@ -0,0 +1,254 @@
+#include "EvdevInput.h"
+#include "Profiles.h"
+#include "Sim.h"
+#include "Trace.h"
+
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+
+#include <spdlog/spdlog.h>
+
+#include <stdexcept>
+
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <linux/input.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace
+{
+constexpr size_t kBitsPerLong = sizeof(unsigned long) * 8;
+constexpr size_t kKeyBitsLongs = (KEY_MAX + kBitsPerLong) / kBitsPerLong;
+
+bool testBit(const unsigned long* bits, int bit)
+{
+    return (bits[bit / kBitsPerLong] >> (bit % kBitsPerLong)) & 1;
+}
+
+// same button numbering as SDL's linux backend: joystick buttons first, then the rest
+std::vector<int> buttonMap(const unsigned long* keyBits)
+{
+    std::vector<int> buttons(KEY_MAX, -1);
+    int index = 0;
+    for (int code = BTN_JOYSTICK; code < KEY_MAX; ++code)
+        if (testBit(keyBits, code)) buttons[code] = index++;
+    for (int code = 0; code < BTN_JOYSTICK; ++code)
+        if (testBit(keyBits, code)) buttons[code] = index++;
+    return buttons;
+}
+
+int64_t toNs(const timeval& time)
+{
+    return static_cast<int64_t>(time.tv_sec) * 1000000000 + static_cast<int64_t>(time.tv_usec) * 1000;
+}
+
+int64_t monotonicNowNs()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+}  // namespace
+
+EvdevInput::EvdevInput(const std::map<int, DeviceSettings>& devices)
+{
+    epoll_ = Fd(epoll_create1(EPOLL_CLOEXEC));
+    if (epoll_.get() < 0) throw std::runtime_error(fmt::format("Couldn't create epoll: {}", std::strerror(errno)));
+
+    devices_.reserve(devices.size());
+    for (const auto& [number, settings] : devices)
+    {
+        Device device;
+        device.number = number;
+        device.path = settings.path;
+        device.fd = Fd(open(device.path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC));
+        if (device.fd.get() < 0)
+        {
+            spdlog::error("Couldn't open input device {} ({}): {}", number, device.path, std::strerror(errno));
+            continue;
+        }
+
+        unsigned long keyBits[kKeyBitsLongs] = {};
+        bool eventDevice = ioctl(device.fd.get(), EVIOCGBIT(EV_KEY, sizeof(keyBits)), keyBits) >= 0;
+        if (eventDevice)
+        {
+            int clock = CLOCK_MONOTONIC;
+            device.monotonic = ioctl(device.fd.get(), EVIOCSCLOCKID, &clock) >= 0;
+
+            std::vector<int> keys;
+            for (int code = 0; code < KEY_MAX; ++code)
+                if (testBit(keyBits, code)) keys.push_back(code);
+            spdlog::info("Evdev device {} keys: [{}]", number, fmt::join(keys, ", "));
+        }
+
+        if (!settings.keys.empty())
+        {
+            // recorded device layout wins, also for live devices
+            std::fill(std::begin(keyBits), std::end(keyBits), 0);
+            for (int code : settings.keys)
+            {
+                if (code < 0 || code >= KEY_MAX)
+                    throw std::runtime_error(fmt::format("Invalid key code {} for input device {}", code, number));
+                keyBits[code / kBitsPerLong] |= 1UL << (code % kBitsPerLong);
+            }
+        }
+        else if (!eventDevice)
+        {
+            throw std::runtime_error(fmt::format(
+                "Input device {} ({}) is not an event device, set Keys to the recorded device's key codes", number,
+                device.path));
+        }
+
+        device.buttons = buttonMap(keyBits);
+
+        devices_.push_back(std::move(device));
+    }
+
+    for (size_t i = 0; i < devices_.size(); ++i)
+    {
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u64 = i;
+        if (epoll_ctl(epoll_.get(), EPOLL_CTL_ADD, devices_[i].fd.get(), &ev) < 0)
+            throw std::runtime_error(
+                fmt::format("Couldn't watch input device {}: {}", devices_[i].path, std::strerror(errno)));
+
+        spdlog::info("Capturing evdev device {} ({}){}", devices_[i].number, devices_[i].path,
+                     devices_[i].monotonic ? "" : ", no kernel timestamps");
+    }
+}
+
+EvdevInput::~EvdevInput()
+{
+    if (latencySamples_ > 0)
+        spdlog::info("evdev: {} events, latency avg {:.1f} us, max {:.1f} us", events_,
+                     latencySumNs_ / 1000.0 / latencySamples_, latencyMaxNs_ / 1000.0);
+}
+
+void EvdevInput::poll(int timeoutMs, Profiles& profiles, Sim& sim)
+{
+    epoll_event ready[16];
+    int count = epoll_wait(epoll_.get(), ready, std::size(ready), timeoutMs);
+    if (count < 0)
+    {
+        if (errno != EINTR) spdlog::error("epoll_wait failed: {}", std::strerror(errno));
+        return;
+    }
+
+    for (int i = 0; i < count; ++i) read(devices_[ready[i].data.u64], profiles, sim);
+}
+
+void EvdevInput::read(Device& device, Profiles& profiles, Sim& sim)
+{
+    static_assert(sizeof(Device::partial) >= sizeof(input_event));
+    alignas(input_event) unsigned char buffer[sizeof(input_event) * 64];
+
+    for (;;)
+    {
+        size_t carried = device.partialBytes;
+        std::memcpy(buffer, device.partial, carried);
+
+        ssize_t bytes = ::read(device.fd.get(), buffer + carried, sizeof(buffer) - carried);
+        if (bytes == 0)
+        {
+            spdlog::info("Input stream {} ended", device.path);
+            close(device);
+            return;
+        }
+        if (bytes < 0)
+        {
+            if (errno == EAGAIN || errno == EINTR) return;
+            spdlog::error("Reading input device {} failed: {}", device.path, std::strerror(errno));
+            close(device);
+            return;
+        }
+
+        size_t total = carried + bytes;
+        size_t n = total / sizeof(input_event);
+        device.partialBytes = total % sizeof(input_event);
+        std::memcpy(device.partial, buffer + n * sizeof(input_event), device.partialBytes);
+
+        const auto* events = reinterpret_cast<const input_event*>(buffer);
+        for (size_t i = 0; i < n; ++i)
+        {
+            const input_event& event = events[i];
+            TraceSpan span("Dispatch");
+            switch (event.type)
+            {
+            case EV_KEY:
+            {
+                if (event.code >= device.buttons.size() || event.value == 2) break;  // 2 is autorepeat
+                int button = device.buttons[event.code];
+                if (button < 0) break;
+
+                spdlog::trace("Button event: evdev {}, id {}, pressed {}", device.number, button, event.value);
+                if (profiles.button(device.number, button, event.value != 0, sim))
+                    spdlog::trace("Found button mapping: evdev {}, button {}", device.number, button);
+                break;
+            }
+            case EV_ABS:
+            {
+                // no axis or hat bindings yet, same as for SDL
+                spdlog::trace("Axis event: evdev {}, code {}, value {}", device.number, event.code, event.value);
+                break;
+            }
+            case EV_SYN:
+            {
+                if (event.code == SYN_DROPPED) spdlog::warn("Input device {} dropped events", device.path);
+                break;
+            }
+            }
+
+            if (event.type == EV_SYN || !device.monotonic) continue;
+
+            int64_t latency = monotonicNowNs() - toNs(event.time);
+            ++latencySamples_;
+            latencySumNs_ += latency;
+            if (latency > latencyMaxNs_) latencyMaxNs_ = latency;
+        }
+        events_ += n;
+
+        if (static_cast<size_t>(bytes) < sizeof(buffer) - carried) return;
+    }
+}
+
+void EvdevInput::close(Device& device)
+{
+    if (device.fd.get() < 0) return;
+    epoll_ctl(epoll_.get(), EPOLL_CTL_DEL, device.fd.get(), nullptr);
+    device.fd.reset();
+}
+
+void EvdevInput::Fd::reset()
+{
+    if (fd_ >= 0) ::close(fd_);
+    fd_ = -1;
+}
+
+#else
+
+EvdevInput::EvdevInput(const std::map<int, DeviceSettings>&)
+{
+    throw std::runtime_error("evdev input backend is only available on Linux");
+}
+
+EvdevInput::~EvdevInput() = default;
+
+void EvdevInput::poll(int, Profiles&, Sim&) {}
+
+void EvdevInput::read(Device&, Profiles&, Sim&) {}
+
+void EvdevInput::close(Device&) {}
+
+void EvdevInput::Fd::reset() {}
+
+#endif
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Profiles;
+class Sim;
+
+// Linux input backend reading /dev/input/event* directly with epoll, bypassing
+// SDL's event queue. Any fd producing a raw struct input_event stream works,
+// so recorded streams can be replayed through a named pipe instead of a device.
+class EvdevInput
+{
+public:
+    struct DeviceSettings
+    {
+        std::string path;
+        // EV_KEY codes the device reports, required for pipes so a replay numbers
+        // buttons like the recorded device; logged at startup for live devices
+        std::vector<int> keys;
+    };
+
+    // device number (as in Settings.json) -> event device or pipe
+    explicit EvdevInput(const std::map<int, DeviceSettings>& devices);
+    ~EvdevInput();
+
+    EvdevInput(const EvdevInput&) = delete;
+    EvdevInput& operator=(const EvdevInput&) = delete;
+
+    // waits up to timeoutMs for input and dispatches everything read
+    void poll(int timeoutMs, Profiles& profiles, Sim& sim);
+
+private:
+    // owns a file descriptor, so every throw from the constructor closes what was opened
+    class Fd
+    {
+    public:
+        Fd() = default;
+        explicit Fd(int fd) : fd_(fd) {}
+        ~Fd() { reset(); }
+
+        Fd(Fd&& other) noexcept : fd_(std::exchange(other.fd_, -1)) {}
+        Fd& operator=(Fd&& other) noexcept
+        {
+            if (this != &other)
+            {
+                reset();
+                fd_ = std::exchange(other.fd_, -1);
+            }
+            return *this;
+        }
+
+        [[nodiscard]] int get() const { return fd_; }
+        void reset();
+
+    private:
+        int fd_ = -1;
+    };
+
+    struct Device
+    {
+        int number;
+        std::string path;
+        Fd fd;
+        // kernel timestamps are CLOCK_MONOTONIC, false for pipes (recorded timestamps)
+        bool monotonic = false;
+        std::vector<int> buttons;  // key code -> button index, -1 if not a button
+        // pipes can split an event between reads, sized as struct input_event
+        unsigned char partial[sizeof(long) * 2 + 8];
+        size_t partialBytes = 0;
+    };
+
+    void read(Device& device, Profiles& profiles, Sim& sim);
+    void close(Device& device);
+
+    Fd epoll_;
+    std::vector<Device> devices_;
+
+    uint64_t events_ = 0;
+    uint64_t latencySamples_ = 0;
+    int64_t latencySumNs_ = 0;
+    int64_t latencyMaxNs_ = 0;
+};
@@ -0,0 +1,372 @@
+#include "LoadTest.h"
+#include "Sim.h"
+#include "Trace.h"
+
+#include <fmt/format.h>
+
+#include <spdlog/spdlog.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+// FSUIPC offsets free for general use, load test bindings write there
+constexpr int kScratchOffset = 0x66C0;
+constexpr int kScratchSize = 0x40;
+
+constexpr int kAxisStep = 4096;
+
+// how long the producer waits for in-flight events after a level before counting them lost
+constexpr auto kDrainTimeout = std::chrono::seconds(1);
+
+const Uint8 kHatSequence[] = {SDL_HAT_UP, SDL_HAT_RIGHT, SDL_HAT_DOWN, SDL_HAT_LEFT, SDL_HAT_CENTERED};
+
+int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+int64_t percentile(const std::vector<int64_t>& sorted, double p)
+{
+    if (sorted.empty()) return 0;
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+}  // namespace
+
+LoadTest::LoadTest(const boost::property_tree::ptree& settings)
+{
+    auto patternStr = boost::algorithm::to_lower_copy(settings.get<std::string>("Pattern", "mixed"));
+    std::map<std::string, Pattern> settingsStrToPattern = {
+        {"buttons", Pattern::Buttons}, {"axes", Pattern::Axes}, {"hats", Pattern::Hats}, {"mixed", Pattern::Mixed}};
+
+    auto patternFound = settingsStrToPattern.find(patternStr);
+    if (patternFound == settingsStrToPattern.end())
+        throw std::runtime_error(fmt::format("Unknown load test pattern: {}", patternStr));
+    pattern_ = patternFound->second;
+
+    joystickCount_ = settings.get<int>("Joysticks", 1);
+    axes_ = settings.get<int>("Axes", 6);
+    buttons_ = settings.get<int>("Buttons", 32);
+    hats_ = settings.get<int>("Hats", 1);
+    levelDuration_ = std::chrono::seconds(settings.get<int>("LevelSeconds", 5));
+
+    for (const auto& rate : settings.get_child("Rates")) rates_.push_back(rate.second.get_value<int>());
+
+    if (joystickCount_ <= 0 || rates_.empty()) throw std::runtime_error("Load test needs joysticks and rates");
+
+    if ((pattern_ == Pattern::Buttons && buttons_ <= 0) || (pattern_ == Pattern::Axes && axes_ <= 0) ||
+        (pattern_ == Pattern::Hats && hats_ <= 0) || axes_ + buttons_ + hats_ <= 0)
+        throw std::runtime_error("Load test pattern has no controls to drive");
+}
+
+LoadTest::~LoadTest()
+{
+    stop_ = true;
+    if (producer_.joinable()) producer_.join();
+
+    for (SDL_Joystick* joystick : joysticks_) SDL_JoystickClose(joystick);
+
+    // device indices shift on detach, go from the last one
+    for (auto it = deviceIndices_.rbegin(); it != deviceIndices_.rend(); ++it) SDL_JoystickDetachVirtual(*it);
+}
+
+std::vector<LoadTest::Device> LoadTest::attach(int firstDevice)
+{
+    std::vector<Device> devices;
+
+    for (int i = 0; i < joystickCount_; i++)
+    {
+        int deviceIndex = SDL_JoystickAttachVirtual(SDL_JOYSTICK_TYPE_UNKNOWN, axes_, buttons_, hats_);
+        if (deviceIndex < 0)
+            throw std::runtime_error(fmt::format("Couldn't attach virtual joystick: {}", SDL_GetError()));
+        deviceIndices_.push_back(deviceIndex);
+
+        SDL_Joystick* joystick = SDL_JoystickOpen(deviceIndex);
+        if (!joystick) throw std::runtime_error(fmt::format("Couldn't open virtual joystick: {}", SDL_GetError()));
+        joysticks_.push_back(joystick);
+
+        SDL_JoystickID id = SDL_JoystickInstanceID(joystick);
+        joystickSlots_[id] = joysticks_.size() - 1;
+
+        Device& device = devices.emplace_back();
+        device.number = firstDevice + i;
+        device.instance = id;
+        for (int b = 0; b < buttons_; b++)
+        {
+            Button& button = device.mapping.buttons[b];
+            button.operation = Operation::Delta;
+            button.offset = kScratchOffset + (b * 2) % kScratchSize;
+            button.size = 2;
+            button.value = 1;
+        }
+        spdlog::info("Attached virtual joystick {} (instance {}) as device {}", deviceIndex, id, device.number);
+
+        size_t slot = joysticks_.size() - 1;
+        if (pattern_ == Pattern::Axes || pattern_ == Pattern::Mixed)
+            for (int a = 0; a < axes_; a++) controls_.push_back({slot, Kind::Axis, a, 0});
+        if (pattern_ == Pattern::Buttons || pattern_ == Pattern::Mixed)
+            for (int b = 0; b < buttons_; b++) controls_.push_back({slot, Kind::Button, b, 0});
+        if (pattern_ == Pattern::Hats || pattern_ == Pattern::Mixed)
+            for (int h = 0; h < hats_; h++) controls_.push_back({slot, Kind::Hat, h, 0});
+    }
+
+    // interleave joysticks so mixed traffic doesn't come in per-device bursts
+    std::stable_sort(controls_.begin(), controls_.end(),
+                     [](const Control& a, const Control& b) { return a.index < b.index; });
+
+    pendingCount_ = joysticks_.size() * (axes_ + buttons_ + hats_);
+    pending_ = std::make_unique<std::atomic<int64_t>[]>(pendingCount_);
+    for (size_t i = 0; i < pendingCount_; ++i) pending_[i] = 0;
+
+    return devices;
+}
+
+size_t LoadTest::stampIndex(size_t joystick, Kind kind, int index) const
+{
+    size_t base = joystick * (axes_ + buttons_ + hats_);
+    switch (kind)
+    {
+    case Kind::Axis:
+        return base + index;
+    case Kind::Button:
+        return base + axes_ + index;
+    case Kind::Hat:
+    default:
+        return base + axes_ + buttons_ + index;
+    }
+}
+
+void LoadTest::startLevel(size_t level, const Sim& sim)
+{
+    spdlog::info("Load test level {}: offering {} events/s for {} s", level + 1, rates_[level],
+                 std::chrono::duration_cast<std::chrono::seconds>(levelDuration_).count());
+
+    injected_ = 0;
+    backlog_ = 0;
+    inFlightMax_ = 0;
+    levelNs_ = 0;
+    for (size_t i = 0; i < pendingCount_; ++i) pending_[i] = 0;
+
+    dispatched_ = 0;
+    simWritesAtStart_ = sim.writesProcessed();
+    sinkStatsAtStart_.clear();
+    for (const auto& sink : sim.sinks()) sinkStatsAtStart_.push_back(sink->stats());
+    queueSamples_ = 0;
+    queueDepthSum_ = 0;
+    queueDepthMax_ = 0;
+    latenciesNs_.clear();
+}
+
+void LoadTest::report(const Sim& sim)
+{
+    size_t level = reported_.load();
+    double seconds = levelNs_.load() / 1e9;
+    std::sort(latenciesNs_.begin(), latenciesNs_.end());
+
+    auto us = [](int64_t ns) { return ns / 1000.0; };
+
+    spdlog::info(
+        "Load test level {}: offered {}/s, injected {:.0f}/s, dispatched {:.0f}/s, sim writes {:.0f}/s, "
+        "backlog {}, lost {}, queue depth avg {:.1f} max {}, in flight max {}, "
+        "latency us p50 {:.1f} p90 {:.1f} p99 {:.1f} max {:.1f}",
+        level + 1, rates_[level], injected_.load() / seconds, dispatched_ / seconds,
+        (sim.writesProcessed() - simWritesAtStart_) / seconds, backlog_.load(), inFlight(),
+        queueSamples_ ? static_cast<double>(queueDepthSum_) / queueSamples_ : 0.0, queueDepthMax_,
+        inFlightMax_.load(), us(percentile(latenciesNs_, 0.5)), us(percentile(latenciesNs_, 0.9)),
+        us(percentile(latenciesNs_, 0.99)), us(percentile(latenciesNs_, 1.0)));
+
+    if (backlog_.load() > 0)
+        spdlog::warn("Load test level {}: saturated, {} offered events could not be injected", level + 1,
+                     backlog_.load());
+
+    for (size_t i = 0; i < sim.sinks().size() && i < sinkStatsAtStart_.size(); ++i)
+    {
+        const auto& sink = sim.sinks()[i];
+        auto stats = sink->stats();
+        spdlog::info("Load test level {}: output {} delivered {:.0f}/s, dropped {:.0f}/s", level + 1, sink->name(),
+                     (stats.writes - sinkStatsAtStart_[i].writes) / seconds,
+                     (stats.dropped - sinkStatsAtStart_[i].dropped) / seconds);
+    }
+}
+
+void LoadTest::tick(const Sim& sim)
+{
+    if (finished()) return;
+
+    if (!producer_.joinable())
+    {
+        startLevel(0, sim);
+        producer_ = std::thread(&LoadTest::produce, this);
+    }
+
+    SDL_PumpEvents();
+    int depth = SDL_PeepEvents(nullptr, 0, SDL_PEEKEVENT, SDL_JOYAXISMOTION, SDL_JOYBUTTONUP);
+    if (depth > 0)
+    {
+        queueDepthSum_ += depth;
+        queueDepthMax_ = std::max(queueDepthMax_, depth);
+    }
+    ++queueSamples_;
+
+    size_t level = reported_.load();
+    if (completed_.load() <= level) return;
+
+    report(sim);
+    if (level + 1 < rates_.size())
+        startLevel(level + 1, sim);
+    else
+        spdlog::info("Load test finished");
+
+    // lets the producer go on with the next level
+    reported_ = level + 1;
+}
+
+size_t LoadTest::inFlight() const
+{
+    size_t count = 0;
+    for (size_t i = 0; i < pendingCount_; ++i)
+        if (pending_[i].load(std::memory_order_relaxed) != 0) ++count;
+    return count;
+}
+
+void LoadTest::produce()
+{
+    setTraceThreadName("load test");
+
+    for (size_t level = 0; level < rates_.size(); ++level)
+    {
+        // the main loop resets its stats before reporting the previous level as done
+        while (reported_.load() < level)
+        {
+            if (stop_) return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        const double rate = rates_[level];
+        const auto start = Clock::now();
+        auto now = start;
+        uint64_t injected = 0;
+
+        for (; now - start < levelDuration_; now = Clock::now())
+        {
+            if (stop_) return;
+
+            auto due = static_cast<uint64_t>(rate * std::chrono::duration<double>(now - start).count());
+            while (injected < due)
+            {
+                // next control whose previous event has been dispatched
+                size_t tries = 0;
+                while (tries < controls_.size())
+                {
+                    const Control& control = controls_[cursor_];
+                    if (pending_[stampIndex(control.joystick, control.kind, control.index)].load() == 0) break;
+                    cursor_ = (cursor_ + 1) % controls_.size();
+                    ++tries;
+                }
+                if (tries == controls_.size()) break;
+
+                inject(controls_[cursor_]);
+                cursor_ = (cursor_ + 1) % controls_.size();
+                ++injected;
+            }
+
+            injected_ = injected;
+            backlog_ = due - injected;
+            inFlightMax_ = std::max<uint64_t>(inFlightMax_.load(), inFlight());
+
+            if (injected < due)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));  // saturated, wait for dispatch
+                continue;
+            }
+
+            auto next = std::chrono::duration<double>((injected + 1) / rate);
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(next));
+        }
+
+        levelNs_ = std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count();
+
+        // let events still in flight be dispatched and counted in this level
+        for (auto drainEnd = Clock::now() + kDrainTimeout; inFlight() > 0 && Clock::now() < drainEnd;)
+        {
+            if (stop_) return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        completed_ = level + 1;
+    }
+}
+
+void LoadTest::inject(Control& control)
+{
+    SDL_Joystick* joystick = joysticks_[control.joystick];
+    pending_[stampIndex(control.joystick, control.kind, control.index)] = nowNs();
+
+    switch (control.kind)
+    {
+    case Kind::Axis:
+    {
+        // sweep full range, wrapping around at the end
+        control.state += kAxisStep;
+        if (control.state > SDL_JOYSTICK_AXIS_MAX) control.state = SDL_JOYSTICK_AXIS_MIN;
+        SDL_JoystickSetVirtualAxis(joystick, control.index, static_cast<Sint16>(control.state));
+        break;
+    }
+    case Kind::Button:
+    {
+        control.state = !control.state;
+        SDL_JoystickSetVirtualButton(joystick, control.index, control.state ? SDL_PRESSED : SDL_RELEASED);
+        break;
+    }
+    case Kind::Hat:
+    {
+        control.state = (control.state + 1) % std::size(kHatSequence);
+        SDL_JoystickSetVirtualHat(joystick, control.index, kHatSequence[control.state]);
+        break;
+    }
+    }
+}
+
+void LoadTest::onEvent(const SDL_Event& event)
+{
+    Kind kind;
+    int index;
+    SDL_JoystickID id;
+
+    switch (event.type)
+    {
+    case SDL_JOYAXISMOTION:
+        kind = Kind::Axis;
+        index = event.jaxis.axis;
+        id = event.jaxis.which;
+        break;
+    case SDL_JOYBUTTONDOWN:
+    case SDL_JOYBUTTONUP:
+        kind = Kind::Button;
+        index = event.jbutton.button;
+        id = event.jbutton.which;
+        break;
+    case SDL_JOYHATMOTION:
+        kind = Kind::Hat;
+        index = event.jhat.hat;
+        id = event.jhat.which;
+        break;
+    default:
+        return;
+    }
+
+    auto slot = joystickSlots_.find(id);
+    if (slot == joystickSlots_.end()) return;
+
+    int64_t stamp = pending_[stampIndex(slot->second, kind, index)].exchange(0);
+    if (stamp == 0) return;  // e.g. initial axis value sent by SDL
+
+    latenciesNs_.push_back(nowNs() - stamp);
+    ++dispatched_;
+}
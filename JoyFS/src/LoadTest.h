@@ -0,0 +1,131 @@
+#pragma once
+
+#include "Mapping.h"
+#include "OutputSink.h"
+
+#include <boost/property_tree/ptree.hpp>
+
+#include <SDL2/SDL.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+class Sim;
+
+// Drives synthetic input through SDL virtual joysticks to find out how much event
+// traffic the main loop sustains. A producer thread offers events at each configured
+// rate independently of the main loop; every level is reported with achieved
+// throughput, backlog, queue depth and injection-to-dispatch latency percentiles.
+class LoadTest
+{
+public:
+    explicit LoadTest(const boost::property_tree::ptree& settings);
+    ~LoadTest();
+
+    LoadTest(const LoadTest&) = delete;
+    LoadTest& operator=(const LoadTest&) = delete;
+
+    struct Device
+    {
+        int number;  // device number to bind the mapping to
+        SDL_JoystickID instance;
+        Joystick mapping;
+    };
+
+    // attach virtual joysticks numbered from firstDevice up, so they don't
+    // replace bindings of configured devices, returns their button mappings
+    std::vector<Device> attach(int firstDevice);
+
+    // called once per main loop cycle before event drain: starts the producer,
+    // samples the event queue and reports finished levels
+    void tick(const Sim& sim);
+
+    // called for every event after it has been dispatched
+    void onEvent(const SDL_Event& event);
+
+    [[nodiscard]] bool finished() const { return reported_.load() >= rates_.size(); }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Pattern
+    {
+        Buttons,
+        Axes,
+        Hats,
+        Mixed
+    };
+
+    enum class Kind
+    {
+        Axis,
+        Button,
+        Hat
+    };
+
+    struct Control
+    {
+        size_t joystick;
+        Kind kind;
+        int index;
+        int state;
+    };
+
+    // producer thread
+    void produce();
+    void inject(Control& control);
+    [[nodiscard]] size_t inFlight() const;
+
+    void startLevel(size_t level, const Sim& sim);
+    void report(const Sim& sim);
+    [[nodiscard]] size_t stampIndex(size_t joystick, Kind kind, int index) const;
+
+    Pattern pattern_ = Pattern::Mixed;
+    int joystickCount_ = 1;
+    int axes_ = 0;
+    int buttons_ = 0;
+    int hats_ = 0;
+    std::vector<int> rates_;
+    Clock::duration levelDuration_;
+
+    std::vector<SDL_Joystick*> joysticks_;
+    std::vector<int> deviceIndices_;
+    std::map<SDL_JoystickID, size_t> joystickSlots_;
+
+    std::vector<Control> controls_;
+    size_t cursor_ = 0;
+
+    // injection time (ns) of the not yet dispatched event per control, 0 if none.
+    // Set by the producer, cleared by the main loop on dispatch. Virtual joysticks
+    // report state, not edges, so a control is only changed again once dispatched.
+    std::unique_ptr<std::atomic<int64_t>[]> pending_;
+    size_t pendingCount_ = 0;
+
+    std::thread producer_;
+    std::atomic<bool> stop_{false};
+
+    // levels finished by the producer and reported by the main loop; the producer
+    // starts the next level only after the previous one has been reported
+    std::atomic<size_t> completed_{0};
+    std::atomic<size_t> reported_{0};
+
+    // current level, written by the producer
+    std::atomic<uint64_t> injected_{0};
+    std::atomic<uint64_t> backlog_{0};  // offered but not injected: every control was in flight
+    std::atomic<uint64_t> inFlightMax_{0};
+    std::atomic<int64_t> levelNs_{0};
+
+    // current level, written by the main loop
+    uint64_t dispatched_ = 0;
+    uint64_t simWritesAtStart_ = 0;
+    std::vector<OutputSink::Stats> sinkStatsAtStart_;
+    uint64_t queueSamples_ = 0;
+    uint64_t queueDepthSum_ = 0;
+    int queueDepthMax_ = 0;
+    std::vector<int64_t> latenciesNs_;
+};
@@ -2,6 +2,11 @@
 #include "ReadSettings.h"
 #include "Sim.h"
 #include "Logging.h"
+#include "LoadTest.h"
+#include "Profiles.h"
+#include "SocketSink.h"
+#include "EvdevInput.h"
+#include "Trace.h"
 
 #include <fmt/format.h>
 
@@ -15,12 +20,18 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_events.h>
 
+#ifdef _WIN32
 #include <windows.h>
+#endif
 
 #include <stdio.h>
+#include <chrono>
 #include <filesystem>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 using namespace std;
 
@@ -28,25 +39,6 @@ using boost::property_tree::ptree;
 using std::filesystem::file_time_type;
 using std::filesystem::path;
 
-enum class Operation
-{
-    Delta,
-    Set
-};
-
-struct Button
-{
-    Operation operation;
-    int offset;
-    int size;
-    int value;
-};
-
-struct Joystick
-{
-    std::map<int, Button> buttons;
-};
-
 int main(int argc, char** argv)
 {
     try
@@ -56,10 +48,11 @@ int main(int argc, char** argv)
 
         ptree settings = readSettings(settingsPath);
         ptree appSettings = settings.get_child("App");
-        ptree joySettings = settings.get_child("Joysticks");
 
         initLogging(appSettings);
 
+        if (auto traceSettings = settings.get_child_optional("Trace")) initTracing(*traceSettings);
+
         SDL_SetMainReady();
 
         if (SDL_Init(SDL_INIT_JOYSTICK) < 0)
@@ -75,51 +68,111 @@ int main(int argc, char** argv)
 
         SDL_JoystickEventState(SDL_ENABLE);
 
-        std::map<SDL_JoystickID, Joystick> joysticks;
-        for (const auto& joy : joySettings)
-        {
-            int id = boost::lexical_cast<int>(joy.first);
-            spdlog::info("Capturing device {}", id);
-            SDL_Joystick* joystick = SDL_JoystickOpen(id);
-            Joystick joystickSettings;
-            for (const auto& button : joy.second.get_child("Buttons"))
-            {
-                int id = boost::lexical_cast<int>(button.first);
-                spdlog::info("Adding button {}", id);
-
-                Button b;
-                b.operation = Operation::Delta;  // fixme
+        auto inputBackend = boost::algorithm::to_lower_copy(appSettings.get<std::string>("InputBackend", "sdl"));
+        spdlog::info("Input backend {}", inputBackend);
 
-                auto hexStr = button.second.get<std::string>("Offset");
-                b.offset = std::stoul(hexStr, nullptr, 16);
+        Profiles profiles(settings);
 
-                b.size = button.second.get<int>("Size");
-                b.value = button.second.get<int>("Value");
+        // SDL instance id -> device number
+        std::vector<int> devices;
+        auto bindDevice = [&devices](SDL_JoystickID instance, int device)
+        {
+            if (instance < 0) return;
+            if (static_cast<size_t>(instance) >= devices.size()) devices.resize(instance + 1, -1);
+            devices[instance] = device;
+        };
+        auto deviceOf = [&devices](SDL_JoystickID instance)
+        { return instance >= 0 && static_cast<size_t>(instance) < devices.size() ? devices[instance] : -1; };
+
+        std::unique_ptr<EvdevInput> evdevInput;
+        if (inputBackend == "evdev")
+        {
+            std::map<int, EvdevInput::DeviceSettings> evdevDevices;
+            for (const auto& device : settings.get_child("Evdev.Devices"))
+            {
+                auto& deviceSettings = evdevDevices[boost::lexical_cast<int>(device.first)];
+                deviceSettings.path = device.second.get<std::string>("Path");
+                if (auto keys = device.second.get_child_optional("Keys"))
+                    for (const auto& key : *keys) deviceSettings.keys.push_back(key.second.get_value<int>());
+            }
 
-                spdlog::info("Button {} settings: {}, {}, {}, {}", id, b.operation, b.offset, b.size, b.value);
+            evdevInput = std::make_unique<EvdevInput>(evdevDevices);
+        }
+        else
+        {
+            for (int id : profiles.devices())
+            {
+                spdlog::info("Capturing device {}", id);
+                SDL_Joystick* joystick = SDL_JoystickOpen(id);
+                if (!joystick)
+                {
+                    spdlog::error("Couldn't open device {}: {}", id, SDL_GetError());
+                    continue;
+                }
+                bindDevice(SDL_JoystickInstanceID(joystick), id);
+            }
+        }
 
-                joystickSettings.buttons[id] = b;
+        std::unique_ptr<LoadTest> loadTest;
+        if (auto loadTestSettings = settings.get_child_optional("LoadTest");
+            loadTestSettings && loadTestSettings->get<bool>("Enabled", false))
+        {
+            spdlog::info("Load test mode");
+            loadTest = std::make_unique<LoadTest>(*loadTestSettings);
+            int firstDevice = profiles.devices().empty() ? 0 : *profiles.devices().rbegin() + 1;
+            for (const auto& device : loadTest->attach(firstDevice))
+            {
+                profiles.add(device.number, device.mapping);
+                bindDevice(device.instance, device.number);
             }
-            joysticks[SDL_JoystickInstanceID(joystick)] = joystickSettings;
         }
 
         spdlog::info("Starting event processing cycle");
 
         bool end = false;
         int pollingDelayMs = appSettings.get<int>("PollingDelayMs");
+        if (loadTest) pollingDelayMs = settings.get<int>("LoadTest.PollingDelayMs", pollingDelayMs);
         spdlog::info("Polling delay {}", pollingDelayMs);
         SDL_Event event;
 
-        Sim sim;
+        Sim sim(loadTest != nullptr);
+        profiles.watch(sim);
+
+        if (auto outputs = settings.get_child_optional("Outputs"))
+        {
+            for (const auto& output : *outputs)
+            {
+                if (!output.second.get<bool>("Enabled", true)) continue;
+                sim.addSink(std::make_unique<SocketSink>(output.first, output.second));
+            }
+        }
 
         for (; !end;)
         {
-            std::this_thread::sleep_for(std::chrono::milliseconds(pollingDelayMs));
+            if (traceDumpRequested()) dumpTrace();
+
+            {
+                TraceSpan span("Wait");
+                if (evdevInput)
+                    evdevInput->poll(pollingDelayMs, profiles, sim);
+                else
+                    std::this_thread::sleep_for(std::chrono::milliseconds(pollingDelayMs));
+            }
 
             sim.process();
+            profiles.update(sim);
+
+            if (loadTest)
+            {
+                TraceSpan span("Load test");
+                loadTest->tick(sim);
+                end = loadTest->finished();
+            }
 
+            TraceSpan drainSpan("Event drain");
             while (SDL_PollEvent(&event))
             {
+                TraceSpan span("Dispatch");
                 switch (event.type)
                 {
                 case SDL_JOYHATMOTION:
@@ -133,14 +186,9 @@ int main(int argc, char** argv)
                 {
                     spdlog::trace("Button event: joy {}, id {}, pressed {}", event.jbutton.which, event.jbutton.button,
                                   event.jbutton.state);
-                    // get id
-                    auto joy = joysticks.find(event.jbutton.which);
-                    if (joy == joysticks.end()) break;
-
-                    auto button = joy->second.buttons.find(event.jbutton.button);
-                    if (button == joy->second.buttons.end()) break;
-
-                    spdlog::trace("Found button mapping: joy {}, button {}", joy->first, button->first);
+                    int device = deviceOf(event.jbutton.which);
+                    if (profiles.button(device, event.jbutton.button, event.jbutton.state == SDL_PRESSED, sim))
+                        spdlog::trace("Found button mapping: joy {}, button {}", device, event.jbutton.button);
 
                     break;
                 }
@@ -151,6 +199,8 @@ int main(int argc, char** argv)
                     break;
                 }
                 }
+
+                if (loadTest) loadTest->onEvent(event);
             }
         }
     }
@@ -163,6 +213,8 @@ int main(int argc, char** argv)
         spdlog::critical("Unknown exception");
     }
 
+    dumpTrace();
+
     SDL_Quit();
     spdlog::shutdown();
     return 0;
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <map>
+#include <optional>
+
+enum class Operation
+{
+    Delta,
+    Set
+};
+
+struct Button
+{
+    Operation operation;
+    int offset;
+    int size;
+    int value;
+    // set on button release (Set operations, e.g. momentary switches)
+    std::optional<int> releaseValue;
+};
+
+struct Joystick
+{
+    std::map<int, Button> buttons;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// offset write with its final value, deltas already resolved
+struct OffsetWrite
+{
+    int offset;
+    int size;
+    int value;
+};
+
+// Receives every batch of offset writes Sim sends out. Sinks other than FSUIPC
+// must not block the caller: they buffer and deliver on their own thread.
+class OutputSink
+{
+public:
+    struct Stats
+    {
+        uint64_t writes = 0;   // delivered
+        uint64_t dropped = 0;  // lost to a full buffer or failed delivery
+    };
+
+    explicit OutputSink(std::string name) : name_(std::move(name)) {}
+    virtual ~OutputSink() = default;
+
+    OutputSink(const OutputSink&) = delete;
+    OutputSink& operator=(const OutputSink&) = delete;
+
+    [[nodiscard]] const std::string& name() const { return name_; }
+    [[nodiscard]] Stats stats() const { return {writes_.load(), dropped_.load()}; }
+
+    // called from the main loop with every batch, returns false if the sink failed
+    virtual bool write(const std::vector<OffsetWrite>& writes) = 0;
+
+protected:
+    std::atomic<uint64_t> writes_{0};
+    std::atomic<uint64_t> dropped_{0};
+
+private:
+    std::string name_;
+};
@@ -0,0 +1,153 @@
+#include "Profiles.h"
+#include "ReadSettings.h"
+#include "Sim.h"
+#include "Trace.h"
+
+#include <spdlog/spdlog.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include <chrono>
+#include <stdexcept>
+
+using boost::property_tree::ptree;
+
+namespace
+{
+// FSUIPC aircraft title and .AIR file path, zero terminated
+constexpr int kAircraftNameOffset = 0x3D00;
+constexpr int kAircraftPathOffset = 0x3C00;
+constexpr int kAircraftStringSize = 256;
+
+std::string toString(const std::vector<uint8_t>& data)
+{
+    std::string str(data.begin(), data.end());
+    return str.substr(0, str.find('\0'));
+}
+
+}  // namespace
+
+Profiles::Profiles(const ptree& settings)
+{
+    auto addProfile = [this](std::string name, std::vector<std::string> aircraft, const ptree& joySettings)
+    {
+        spdlog::info("Reading profile {}", name);
+        auto joysticks = readJoysticks(joySettings);
+        for (const auto& joystick : joysticks) devices_.insert(joystick.first);
+        profiles_.push_back({std::move(name), std::move(aircraft), Dispatcher(joysticks)});
+    };
+
+    if (auto joySettings = settings.get_child_optional("Joysticks")) addProfile("Default", {}, *joySettings);
+
+    if (auto profileSettings = settings.get_child_optional("Profiles"))
+    {
+        for (const auto& profile : *profileSettings)
+        {
+            if (!profile.second.get<bool>("Enabled", true)) continue;
+
+            std::vector<std::string> aircraft;
+            if (auto matches = profile.second.get_child_optional("Aircraft"))
+                for (const auto& match : *matches)
+                    aircraft.push_back(boost::algorithm::to_lower_copy(match.second.get_value<std::string>()));
+
+            addProfile(profile.first, std::move(aircraft), profile.second.get_child("Joysticks"));
+        }
+    }
+
+    if (profiles_.empty()) throw std::runtime_error("No joystick profiles configured");
+
+    for (size_t i = 0; i < profiles_.size(); ++i)
+    {
+        if (!profiles_[i].aircraft.empty()) continue;
+        fallback_ = i;
+        break;
+    }
+
+    active_ = &profiles_[fallback_];
+    spdlog::info("Active profile {}", profiles_[fallback_].name);
+}
+
+void Profiles::add(int device, const Joystick& joystick)
+{
+    for (auto& profile : profiles_) profile.dispatcher.add(device, joystick);
+    devices_.insert(device);
+}
+
+void Profiles::watch(Sim& sim)
+{
+    nameSubscription_ = sim.subscribe(kAircraftNameOffset, kAircraftStringSize);
+    pathSubscription_ = sim.subscribe(kAircraftPathOffset, kAircraftStringSize);
+}
+
+const Profiles::Profile& Profiles::select(const std::string& name, const std::string& path) const
+{
+    auto lowerName = boost::algorithm::to_lower_copy(name);
+    auto lowerPath = boost::algorithm::to_lower_copy(path);
+
+    for (const auto& profile : profiles_)
+        for (const auto& match : profile.aircraft)
+            if (lowerName.find(match) != std::string::npos || lowerPath.find(match) != std::string::npos)
+                return profile;
+
+    return profiles_[fallback_];
+}
+
+void Profiles::update(Sim& sim)
+{
+    if (nameSubscription_ < 0) return;
+
+    auto name = toString(sim.data(nameSubscription_));
+    auto path = toString(sim.data(pathSubscription_));
+    if (name == aircraftName_ && path == aircraftPath_) return;
+
+    aircraftName_ = name;
+    aircraftPath_ = path;
+    spdlog::info("Aircraft changed: {} ({})", name, path);
+
+    const Profile& profile = select(name, path);
+    if (&profile != active_.load(std::memory_order_relaxed)) activate(profile, sim);
+}
+
+void Profiles::activate(const Profile& profile, Sim& sim)
+{
+    TraceSpan span("Profile switch");
+    auto start = std::chrono::steady_clock::now();
+
+    const Profile* previous = active_.exchange(&profile, std::memory_order_acq_rel);
+
+    // release buttons through the profile which pressed them, their physical
+    // release is then ignored as the new profile never saw the press
+    for (size_t device = 0; device < held_.size(); ++device)
+    {
+        for (size_t index = 0; index < held_[device].size(); ++index)
+        {
+            if (!held_[device][index]) continue;
+            previous->dispatcher.button(static_cast<int>(device), static_cast<int>(index), false, sim);
+            held_[device][index] = false;
+        }
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    spdlog::info("Switched profile {} -> {} in {} us", previous->name, profile.name, elapsed.count());
+}
+
+bool Profiles::button(int device, int index, bool pressed, Sim& sim)
+{
+    if (device < 0 || index < 0) return false;
+
+    if (static_cast<size_t>(device) >= held_.size()) held_.resize(device + 1);
+    auto& held = held_[device];
+    if (static_cast<size_t>(index) >= held.size()) held.resize(index + 1, false);
+
+    if (!pressed)
+    {
+        if (!held[index]) return false;  // pressed before the last profile switch
+        held[index] = false;
+    }
+    else
+    {
+        held[index] = true;
+    }
+
+    return active_.load(std::memory_order_acquire)->dispatcher.button(device, index, pressed, sim);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Dispatcher.h"
+
+#include <boost/property_tree/ptree.hpp>
+
+#include <atomic>
+#include <set>
+#include <string>
+#include <vector>
+
+class Sim;
+
+// Named joystick profiles, each compiled into its own Dispatcher up front.
+// The active profile follows the aircraft loaded in the sim; switching is a
+// pointer swap, held buttons are released through the profile that pressed them.
+class Profiles
+{
+public:
+    // global "Joysticks" is the default profile, "Profiles" adds aircraft specific ones
+    explicit Profiles(const boost::property_tree::ptree& settings);
+
+    Profiles(const Profiles&) = delete;
+    Profiles& operator=(const Profiles&) = delete;
+
+    // device numbers used by any profile
+    [[nodiscard]] const std::set<int>& devices() const { return devices_; }
+
+    // bind joystick mapping in every profile
+    void add(int device, const Joystick& joystick);
+
+    // subscribe to aircraft name and path offsets
+    void watch(Sim& sim);
+
+    // switch profile if the aircraft changed, called after sim.process()
+    void update(Sim& sim);
+
+    // dispatch through the active profile, returns false if the button has no binding
+    bool button(int device, int index, bool pressed, Sim& sim);
+
+private:
+    struct Profile
+    {
+        std::string name;
+        std::vector<std::string> aircraft;  // lower case substrings of aircraft name or path
+        Dispatcher dispatcher;
+    };
+
+    [[nodiscard]] const Profile& select(const std::string& name, const std::string& path) const;
+    void activate(const Profile& profile, Sim& sim);
+
+    std::vector<Profile> profiles_;
+    size_t fallback_ = 0;
+    std::set<int> devices_;
+
+    std::atomic<const Profile*> active_{nullptr};
+
+    // buttons pressed under the active profile
+    std::vector<std::vector<bool>> held_;
+
+    int nameSubscription_ = -1;
+    int pathSubscription_ = -1;
+    std::string aircraftName_;
+    std::string aircraftPath_;
+};
@@ -1,8 +1,13 @@
 #include "ReadSettings.h"
 
 #include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/property_tree/json_parser.hpp>
 
+#include <fmt/format.h>
+
+#include <stdexcept>
+
 using boost::property_tree::ptree;
 using std::filesystem::file_time_type;
 using std::filesystem::path;
@@ -14,3 +19,44 @@ ptree readSettings(const path& file)
     return settings;
 }
 
+std::map<int, Joystick> readJoysticks(const ptree& joySettings)
+{
+    std::map<int, Joystick> joysticks;
+
+    for (const auto& joy : joySettings)
+    {
+        int joyId = boost::lexical_cast<int>(joy.first);
+        Joystick joystickSettings;
+        for (const auto& button : joy.second.get_child("Buttons"))
+        {
+            int id = boost::lexical_cast<int>(button.first);
+            spdlog::info("Adding button {}", id);
+
+            Button b;
+            auto operationStr = boost::algorithm::to_lower_copy(button.second.get<std::string>("Operation"));
+            b.operation = (operationStr == "set" ? Operation::Set : Operation::Delta);
+
+            auto hexStr = button.second.get<std::string>("Offset");
+            auto offset = std::stoul(hexStr, nullptr, 16);
+            if (offset > 0xFFFF)
+                throw std::runtime_error(
+                    fmt::format("Joystick {} button {}: offset {} is above 0xFFFF", joyId, id, hexStr));
+            b.offset = static_cast<int>(offset);
+
+            // FSUIPC values are read and written through an int32
+            b.size = button.second.get<int>("Size");
+            if (b.size != 1 && b.size != 2 && b.size != 4)
+                throw std::runtime_error(
+                    fmt::format("Joystick {} button {}: size {} is not 1, 2 or 4", joyId, id, b.size));
+            b.value = button.second.get<int>("Value");
+            if (auto releaseValue = button.second.get_optional<int>("ReleaseValue")) b.releaseValue = *releaseValue;
+
+            spdlog::info("Button {} settings: {}, {}, {}, {}", id, operationStr, b.offset, b.size, b.value);
+
+            joystickSettings.buttons[id] = b;
+        }
+        joysticks[joyId] = joystickSettings;
+    }
+
+    return joysticks;
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "Mapping.h"
+
 #include <spdlog/spdlog.h>
 #include <boost/property_tree/ptree.hpp>
 #include <filesystem>
@@ -7,3 +9,6 @@
 
 
 boost::property_tree::ptree readSettings(const std::filesystem::path& file);
+
+// device number -> button bindings, from a "Joysticks" settings node
+std::map<int, Joystick> readJoysticks(const boost::property_tree::ptree& joySettings);
@@ -1,13 +1,83 @@
 #include "Sim.h"
+#include "Trace.h"
 
+#ifdef _WIN32
 #include <windows.h>
 #include "FSUIPC_User64.h"
+#endif
 
 #include <spdlog/spdlog.h>
 
-Sim::Sim()
+namespace
 {
-   connect();
+#ifdef _WIN32
+// FSUIPC_Open is retried no more often than this while the sim is away
+constexpr auto kReconnectDelay = std::chrono::seconds(2);
+
+int signExtend(int32_t value, int size)
+{
+    switch (size)
+    {
+    case 1:
+        return static_cast<int8_t>(value);
+    case 2:
+        return static_cast<int16_t>(value);
+    default:
+        return value;
+    }
+}
+
+bool processFsuipcRequests(DWORD* dwResult)
+{
+    TraceSpan span("FSUIPC_Process");
+    return FSUIPC_Process(dwResult);
+}
+
+// sends each batch to FSUIPC in one FSUIPC_Process call
+class FsuipcSink : public OutputSink
+{
+public:
+    FsuipcSink() : OutputSink("FSUIPC") {}
+
+    bool write(const std::vector<OffsetWrite>& writes) override
+    {
+        DWORD dwResult;
+        for (const auto& write : writes)
+        {
+            int32_t value = write.value;
+            FSUIPC_Write(write.offset, write.size, &value, &dwResult);
+        }
+
+        if (!processFsuipcRequests(&dwResult))
+        {
+            spdlog::error("FSUIPC write failed (error {})", dwResult);
+            dropped_ += writes.size();
+            return false;
+        }
+
+        writes_ += writes.size();
+        return true;
+    }
+};
+#endif
+
+}  // namespace
+
+Sim::Sim(bool mock) : mock_(mock)
+{
+#ifdef _WIN32
+    if (!mock_)
+    {
+        auto fsuipc = std::make_unique<FsuipcSink>();
+        fsuipc_ = fsuipc.get();
+        sinks_.push_back(std::move(fsuipc));
+    }
+#else
+    if (!mock_) spdlog::warn("FSUIPC is only available on Windows");
+    mock_ = true;
+#endif
+
+    connect();
 }
 
 Sim::~Sim()
@@ -17,25 +87,191 @@ Sim::~Sim()
 
 bool Sim::connect()
 {
+    TraceSpan span("Sim::connect");
+
+    if (mock_)
+    {
+        spdlog::info("Using mock sim");
+        connected_ = true;
+        return true;
+    }
+
+#ifdef _WIN32
+    nextConnect_ = std::chrono::steady_clock::now() + kReconnectDelay;
+
     DWORD dwResult;
     bool fsuipcPresent = FSUIPC_Open(SIM_ANY, &dwResult);
     if (fsuipcPresent)
         spdlog::info("FSUIPC found");
+    else if (!connectFailed_)
+        spdlog::error("FSUIPC not found (error {}), retrying every {} s", dwResult, kReconnectDelay.count());
     else
-        spdlog::error("FSUIPC not found (error {})", dwResult);
+        spdlog::debug("FSUIPC not found (error {})", dwResult);
 
     connected_ = fsuipcPresent;
+    connectFailed_ = !fsuipcPresent;
 
     return fsuipcPresent;
+#else
+    return false;
+#endif
 }
 
 void Sim::disconnect()
 {
-    FSUIPC_Close();
+#ifdef _WIN32
+    if (!mock_) FSUIPC_Close();
+#endif
     connected_ = false;
 }
 
-void Sim::process() 
+void Sim::set(int offset, int size, int value)
+{
+    pending_.push_back({offset, size, value, false});
+}
+
+void Sim::add(int offset, int size, int delta)
+{
+    pending_.push_back({offset, size, delta, true});
+}
+
+void Sim::addSink(std::unique_ptr<OutputSink> sink)
+{
+    sinks_.push_back(std::move(sink));
+}
+
+int Sim::subscribe(int offset, int size)
+{
+    subscriptions_.push_back({offset, std::vector<uint8_t>(size, 0)});
+    return static_cast<int>(subscriptions_.size()) - 1;
+}
+
+std::vector<std::vector<Sim::Write>> Sim::coalesce() const
+{
+    std::vector<std::vector<Write>> batches(1);
+    std::map<int, size_t> byOffset;
+
+    for (const auto& write : pending_)
+    {
+        auto it = byOffset.find(write.offset);
+        if (it != byOffset.end() && !write.delta)
+        {
+            // a set would hide the earlier value (e.g. a tap's press under its release), send it in the next batch
+            batches.emplace_back();
+            byOffset.clear();
+            it = byOffset.end();
+        }
+
+        auto& writes = batches.back();
+        if (it == byOffset.end())
+        {
+            byOffset.emplace(write.offset, writes.size());
+            writes.push_back(write);
+            continue;
+        }
+
+        Write& merged = writes[it->second];
+        merged.size = write.size;
+        merged.value += write.value;  // delta on top of set stays set
+    }
+
+    return batches;
+}
+
+void Sim::process()
+{
+    TraceSpan span("Sim::process");
+
+    if (pending_.empty() && subscriptions_.empty()) return;
+
+    if (!connected_ && !mock_ && std::chrono::steady_clock::now() >= nextConnect_) connect();
+
+    if (!connected_)
+    {
+        if (!pending_.empty()) spdlog::trace("Sim not connected, dropping {} writes", pending_.size());
+        pending_.clear();
+        return;
+    }
+
+    auto batches = coalesce();
+    pending_.clear();
+
+    std::vector<OffsetWrite> resolved;
+
+    for (const auto& writes : batches)
+    {
+        resolved.clear();
+        resolved.reserve(writes.size());
+
+        if (mock_)
+            resolveMock(writes, resolved);
+        else if (!resolveFsuipc(writes, resolved))
+        {
+            disconnect();
+            return;
+        }
+
+        if (resolved.empty()) continue;
+
+        for (auto& sink : sinks_)
+        {
+            if (sink->write(resolved)) continue;
+
+            spdlog::error("Output {} failed", sink->name());
+            if (sink.get() == fsuipc_) disconnect();
+        }
+
+        writesProcessed_ += resolved.size();
+
+        if (!connected_) return;
+    }
+}
+
+bool Sim::resolveFsuipc([[maybe_unused]] const std::vector<Write>& writes,
+                        [[maybe_unused]] std::vector<OffsetWrite>& resolved)
+{
+#ifdef _WIN32
+    DWORD dwResult;
+
+    // read subscriptions and current values for deltas first
+    for (auto& subscription : subscriptions_)
+        FSUIPC_Read(subscription.offset, static_cast<DWORD>(subscription.data.size()), subscription.data.data(),
+                    &dwResult);
+
+    std::vector<int32_t> current(writes.size(), 0);
+    bool hasReads = !subscriptions_.empty();
+    for (size_t i = 0; i < writes.size(); ++i)
+    {
+        if (!writes[i].delta) continue;
+        FSUIPC_Read(writes[i].offset, writes[i].size, &current[i], &dwResult);
+        hasReads = true;
+    }
+
+    if (hasReads && !processFsuipcRequests(&dwResult))
+    {
+        spdlog::error("FSUIPC read failed (error {})", dwResult);
+        return false;
+    }
+
+    for (size_t i = 0; i < writes.size(); ++i)
+    {
+        const Write& write = writes[i];
+        int value = write.delta ? signExtend(current[i], write.size) + write.value : write.value;
+        resolved.push_back({write.offset, write.size, value});
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Sim::resolveMock(const std::vector<Write>& writes, std::vector<OffsetWrite>& resolved)
 {
-    
+    for (const auto& write : writes)
+    {
+        int& value = mockOffsets_[write.offset];
+        value = write.delta ? value + write.value : write.value;
+        resolved.push_back({write.offset, write.size, value});
+    }
 }
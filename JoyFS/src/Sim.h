@@ -1,18 +1,74 @@
 #pragma once
 
+#include "OutputSink.h"
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
 class Sim
 {
 public:
-    Sim();
+    // mock sim keeps offsets in memory instead of talking to FSUIPC (used for load testing)
+    explicit Sim(bool mock = false);
     ~Sim();
 
     bool connect();
     void disconnect();
     [[nodiscard]] bool connected() const { return connected_; }
+    [[nodiscard]] bool mock() const { return mock_; }
+
+    // every batch sent to sim is mirrored to added sinks, FSUIPC is the first sink unless mocked
+    void addSink(std::unique_ptr<OutputSink> sink);
+    [[nodiscard]] const std::vector<std::unique_ptr<OutputSink>>& sinks() const { return sinks_; }
+
+    // queue offset changes, they are sent to sim on next process(), in one batch unless an offset is set twice
+    void set(int offset, int size, int value);
+    void add(int offset, int size, int delta);
+
+    // offsets read from sim on every process(), returns subscription id
+    int subscribe(int offset, int size);
+    [[nodiscard]] const std::vector<uint8_t>& data(int subscription) const { return subscriptions_[subscription].data; }
+
+    // update data, reconnects to FSUIPC (rate limited) after it was lost
+    void process();
+
+    [[nodiscard]] uint64_t writesProcessed() const { return writesProcessed_; }
 
-    // update data
-    void process(); 
-    
 private:
-    bool connected_;
-};
\ No newline at end of file
+    struct Write
+    {
+        int offset;
+        int size;
+        int value;
+        bool delta;
+    };
+
+    struct Subscription
+    {
+        int offset;
+        std::vector<uint8_t> data;
+    };
+
+    // merge pending changes to the same offset, keeps first-seen order; a set to an offset already
+    // in the batch starts a new one, so every value set reaches the sim
+    std::vector<std::vector<Write>> coalesce() const;
+
+    // turn deltas into final values, FSUIPC reads subscriptions in the same round trip
+    bool resolveFsuipc(const std::vector<Write>& writes, std::vector<OffsetWrite>& resolved);
+    void resolveMock(const std::vector<Write>& writes, std::vector<OffsetWrite>& resolved);
+
+    bool connected_ = false;
+    bool mock_ = false;
+    bool connectFailed_ = false;  // last attempt failed, retries log quietly
+    std::chrono::steady_clock::time_point nextConnect_;
+
+    std::vector<Write> pending_;
+    std::vector<Subscription> subscriptions_;
+    std::vector<std::unique_ptr<OutputSink>> sinks_;
+    OutputSink* fsuipc_ = nullptr;
+    std::map<int, int> mockOffsets_;
+    uint64_t writesProcessed_ = 0;
+};
@@ -0,0 +1,303 @@
+#include "SocketSink.h"
+#include "Trace.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/asio.hpp>
+
+#include <fmt/format.h>
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+
+namespace
+{
+constexpr size_t kHeaderSize = 6;
+constexpr size_t kRecordSize = 7;
+// keeps UDP datagrams well below the 64K limit
+constexpr size_t kMaxRecordsPerFrame = 1024;
+
+constexpr auto kReconnectDelay = std::chrono::seconds(1);
+// a consumer that stops reading costs at most this per frame, then the frame is dropped
+constexpr auto kSendTimeout = std::chrono::milliseconds(100);
+// how long shutdown may spend delivering what is still queued
+constexpr auto kShutdownTimeout = std::chrono::seconds(1);
+
+template <typename T>
+void put(std::vector<uint8_t>& frame, T value)
+{
+    for (size_t i = 0; i < sizeof(T); ++i) frame.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+}  // namespace
+
+struct SocketSink::Transport
+{
+    boost::asio::io_context io;
+
+    std::optional<boost::asio::ip::udp::socket> udp;
+    boost::asio::ip::udp::endpoint udpEndpoint;
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    std::optional<boost::asio::local::stream_protocol::socket> local;
+    std::string localPath;
+    std::chrono::steady_clock::time_point nextConnect;
+
+    // guards opening and closing the socket against interrupt() from another thread
+    std::mutex mutex;
+    bool interrupted = false;
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        boost::system::error_code ec;
+        local->close(ec);
+    }
+
+    // waits until the socket can take more data, false on timeout
+    bool waitWritable(std::chrono::steady_clock::duration timeout)
+    {
+        bool ready = false;
+        local->async_wait(boost::asio::socket_base::wait_write,
+                          [&ready](const boost::system::error_code& ec) { ready = !ec; });
+        io.restart();
+        io.run_for(timeout);
+        if (!io.stopped())
+        {
+            local->cancel();
+            io.run();
+        }
+        return ready;
+    }
+#endif
+
+    // unblocks the worker for good, the socket is left for it to close
+    void interrupt()
+    {
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+        if (local)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            interrupted = true;
+            boost::system::error_code ec;
+            if (local->is_open()) local->shutdown(boost::asio::socket_base::shutdown_both, ec);
+        }
+#endif
+    }
+
+    // returns false if the frame was not delivered before the deadline
+    bool send(const std::vector<uint8_t>& frame, std::chrono::steady_clock::time_point deadline)
+    {
+        boost::system::error_code ec;
+
+        if (udp)
+        {
+            // non-blocking, a full socket buffer drops the frame
+            udp->send_to(boost::asio::buffer(frame), udpEndpoint, 0, ec);
+            return !ec;
+        }
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+        if (!local->is_open())
+        {
+            auto now = std::chrono::steady_clock::now();
+            if (now < nextConnect) return false;
+            nextConnect = now + kReconnectDelay;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (interrupted) return false;
+                local->open(boost::asio::local::stream_protocol(), ec);
+                // non-blocking connect fails at once when the listener's backlog is full
+                if (!ec) local->non_blocking(true, ec);
+                if (!ec) local->connect(boost::asio::local::stream_protocol::endpoint(localPath), ec);
+            }
+            if (ec)
+            {
+                close();
+                return false;
+            }
+            spdlog::info("Output connected to {}", localPath);
+        }
+
+        size_t sent = 0;
+        while (sent < frame.size())
+        {
+            sent += local->write_some(boost::asio::buffer(frame.data() + sent, frame.size() - sent), ec);
+            if (ec == boost::asio::error::would_block)
+            {
+                auto timeout = std::min<std::chrono::steady_clock::duration>(
+                    kSendTimeout, deadline - std::chrono::steady_clock::now());
+                if (timeout > timeout.zero() && waitWritable(timeout)) continue;
+
+                // a whole frame can be skipped, a partial one breaks the stream
+                if (sent == 0) return false;
+                spdlog::warn("Output to {} stalled, reconnecting", localPath);
+                close();
+                return false;
+            }
+            if (ec)
+            {
+                spdlog::warn("Output to {} disconnected: {}", localPath, ec.message());
+                close();
+                return false;
+            }
+        }
+#endif
+        return true;
+    }
+};
+
+SocketSink::SocketSink(std::string name, const boost::property_tree::ptree& settings)
+    : OutputSink(std::move(name)), transport_(std::make_unique<Transport>())
+{
+    auto type = boost::algorithm::to_lower_copy(settings.get<std::string>("Type"));
+    if (type == "udp")
+    {
+        auto address = boost::asio::ip::make_address(settings.get<std::string>("Address", "127.0.0.1"));
+        transport_->udpEndpoint = {address, settings.get<unsigned short>("Port")};
+        transport_->udp.emplace(transport_->io, transport_->udpEndpoint.protocol());
+        transport_->udp->non_blocking(true);
+        spdlog::info("Output {}: udp {}:{}", this->name(), address.to_string(), transport_->udpEndpoint.port());
+    }
+    else if (type == "unix")
+    {
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+        transport_->localPath = settings.get<std::string>("Path");
+        transport_->local.emplace(transport_->io);
+        spdlog::info("Output {}: unix {}", this->name(), transport_->localPath);
+#else
+        throw std::runtime_error("Unix domain socket outputs are not supported on this platform");
+#endif
+    }
+    else
+    {
+        throw std::runtime_error(fmt::format("Unknown output type: {}", type));
+    }
+
+    capacity_ = settings.get<size_t>("BufferWrites", 65536);
+
+    auto dropPolicyStr = boost::algorithm::to_lower_copy(settings.get<std::string>("DropPolicy", "oldest"));
+    if (dropPolicyStr == "newest")
+        dropPolicy_ = DropPolicy::Newest;
+    else if (dropPolicyStr == "oldest")
+        dropPolicy_ = DropPolicy::Oldest;
+    else
+        throw std::runtime_error(fmt::format("Unknown drop policy: {}", dropPolicyStr));
+
+    thread_ = std::thread(&SocketSink::run, this);
+}
+
+SocketSink::~SocketSink()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stop_ = true;
+        wakeup_.notify_one();
+
+        // let the worker deliver what is queued, but not past the deadline
+        finished_.wait_for(lock, kShutdownTimeout, [this] { return done_; });
+    }
+    transport_->interrupt();
+    thread_.join();
+}
+
+bool SocketSink::write(const std::vector<OffsetWrite>& writes)
+{
+    if (writes.empty()) return true;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        // would never fit, don't evict queued batches for it
+        if (writes.size() > capacity_)
+        {
+            dropped_ += writes.size();
+            return true;
+        }
+
+        if (dropPolicy_ == DropPolicy::Oldest)
+        {
+            while (!queue_.empty() && queued_ + writes.size() > capacity_)
+            {
+                queued_ -= queue_.front().size();
+                dropped_ += queue_.front().size();
+                queue_.pop_front();
+            }
+        }
+
+        if (queued_ + writes.size() > capacity_)
+        {
+            dropped_ += writes.size();
+            return true;
+        }
+
+        queue_.push_back(writes);
+        queued_ += writes.size();
+    }
+
+    wakeup_.notify_one();
+    return true;
+}
+
+void SocketSink::run()
+{
+    setTraceThreadName(name().c_str());
+
+    std::deque<std::vector<OffsetWrite>> batches;
+    std::vector<uint8_t> frame;
+    uint32_t sequence = 0;
+    auto deadline = std::chrono::steady_clock::time_point::max();
+
+    for (bool stop = false; !stop;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wakeup_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+
+            // on stop, still send what is queued until the deadline
+            stop = stop_;
+            if (stop) deadline = std::chrono::steady_clock::now() + kShutdownTimeout;
+            batches.swap(queue_);
+            queued_ = 0;
+        }
+
+        TraceSpan span("Output send");
+
+        for (const auto& batch : batches)
+        {
+            for (size_t first = 0; first < batch.size(); first += kMaxRecordsPerFrame)
+            {
+                size_t count = std::min(kMaxRecordsPerFrame, batch.size() - first);
+
+                frame.clear();
+                frame.reserve(kHeaderSize + count * kRecordSize);
+                put<uint32_t>(frame, sequence++);
+                put<uint16_t>(frame, static_cast<uint16_t>(count));
+                for (size_t i = first; i < first + count; ++i)
+                {
+                    put<uint16_t>(frame, static_cast<uint16_t>(batch[i].offset));
+                    put<uint8_t>(frame, static_cast<uint8_t>(batch[i].size));
+                    put<uint32_t>(frame, static_cast<uint32_t>(batch[i].value));
+                }
+
+                if (std::chrono::steady_clock::now() < deadline && transport_->send(frame, deadline))
+                    writes_ += count;
+                else
+                    dropped_ += count;
+            }
+        }
+
+        batches.clear();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_ = true;
+    }
+    finished_.notify_one();
+}
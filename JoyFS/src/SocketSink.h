@@ -0,0 +1,53 @@
+#pragma once
+
+#include "OutputSink.h"
+
+#include <boost/property_tree/ptree.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Mirrors offset writes as a compact binary stream to localhost UDP or a Unix
+// domain socket. Each frame is: uint32 sequence, uint16 count, then count
+// records of uint16 offset, uint8 size, int32 value, all little endian.
+// Batches are queued to a bounded buffer and sent from a worker thread; when
+// the buffer is full the drop policy decides whether new or old batches go.
+// Sockets are non-blocking: a consumer that stops reading loses frames instead
+// of stalling the worker, and shutdown gives up on it after a deadline.
+class SocketSink : public OutputSink
+{
+public:
+    SocketSink(std::string name, const boost::property_tree::ptree& settings);
+    ~SocketSink() override;
+
+    bool write(const std::vector<OffsetWrite>& writes) override;
+
+private:
+    enum class DropPolicy
+    {
+        Newest,
+        Oldest
+    };
+
+    struct Transport;
+
+    void run();
+
+    std::unique_ptr<Transport> transport_;
+
+    DropPolicy dropPolicy_ = DropPolicy::Oldest;
+    size_t capacity_ = 0;  // in writes
+
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    std::condition_variable finished_;
+    std::deque<std::vector<OffsetWrite>> queue_;
+    size_t queued_ = 0;
+    bool stop_ = false;
+    bool done_ = false;  // worker has sent or dropped everything
+
+    std::thread thread_;
+};
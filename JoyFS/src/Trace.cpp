@@ -0,0 +1,213 @@
+#include "Trace.h"
+
+#include <spdlog/spdlog.h>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <csignal>
+#endif
+
+std::atomic<bool> g_traceEnabled{false};
+
+namespace
+{
+// Written by the owning thread only and read by dumpTrace() from another one.
+// seq is the record number + 1 once complete and 0 while being written, so a
+// reader can tell a consistent copy from one torn by a concurrent overwrite.
+struct Record
+{
+    std::atomic<uint64_t> seq{0};
+    std::atomic<const char*> name{nullptr};
+    std::atomic<int64_t> begin{0};
+    std::atomic<int64_t> end{0};
+};
+
+struct Ring
+{
+    std::unique_ptr<Record[]> records;
+    size_t size = 0;  // power of two
+    std::atomic<uint64_t> head{0};
+    int tid = 0;
+    std::string name;
+};
+
+struct Tracer
+{
+    std::mutex mutex;
+    std::vector<std::shared_ptr<Ring>> rings;
+    size_t capacity = 1 << 16;
+    int64_t lastNs = 0;
+    int64_t startNs = 0;
+    std::string file;
+};
+
+Tracer g_tracer;
+std::atomic<bool> g_dumpRequested{false};
+
+thread_local Ring* t_ring = nullptr;
+thread_local std::string t_name;
+
+Ring& threadRing()
+{
+    if (t_ring) return *t_ring;
+
+    auto ring = std::make_shared<Ring>();
+    std::lock_guard<std::mutex> lock(g_tracer.mutex);
+    ring->records = std::make_unique<Record[]>(g_tracer.capacity);
+    ring->size = g_tracer.capacity;
+    ring->tid = static_cast<int>(g_tracer.rings.size()) + 1;
+    ring->name = t_name.empty() ? fmt::format("thread {}", ring->tid) : t_name;
+    g_tracer.rings.push_back(ring);
+    t_ring = ring.get();
+    return *t_ring;
+}
+
+#ifdef _WIN32
+BOOL WINAPI consoleHandler(DWORD ctrlType)
+{
+    if (ctrlType != CTRL_BREAK_EVENT) return FALSE;
+    g_dumpRequested = true;
+    return TRUE;
+}
+#else
+void signalHandler(int)
+{
+    g_dumpRequested = true;
+}
+#endif
+
+void writeEscaped(std::FILE* out, const std::string& str)
+{
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\') std::fputc('\\', out);
+        std::fputc(c, out);
+    }
+}
+
+}  // namespace
+
+void initTracing(const boost::property_tree::ptree& settings)
+{
+    if (!settings.get<bool>("Enabled", false)) return;
+
+    size_t capacity = 1;
+    for (size_t requested = settings.get<size_t>("BufferEvents", 1 << 16); capacity < requested;) capacity <<= 1;
+
+    g_tracer.capacity = capacity;
+    g_tracer.lastNs = settings.get<int64_t>("LastSeconds", 0) * 1000000000;
+    g_tracer.file = settings.get<std::string>("File", "joyfs_trace.json");
+    g_tracer.startNs = traceNow();
+
+#ifdef _WIN32
+    SetConsoleCtrlHandler(consoleHandler, TRUE);
+#else
+    std::signal(SIGUSR1, signalHandler);
+#endif
+
+    g_traceEnabled = true;
+    setTraceThreadName("main");
+
+    spdlog::info("Tracing to {}, {} spans per thread, last {} s", g_tracer.file, capacity,
+                 g_tracer.lastNs / 1000000000);
+}
+
+void setTraceThreadName(const char* name)
+{
+    t_name = name;
+
+    // with tracing on, allocate the ring now rather than inside the thread's first span
+    if (!t_ring)
+    {
+        if (g_traceEnabled) threadRing();
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(g_tracer.mutex);
+    t_ring->name = name;
+}
+
+void traceRecord(const char* name, int64_t begin, int64_t end)
+{
+    Ring& ring = threadRing();
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    Record& record = ring.records[head & (ring.size - 1)];
+
+    record.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    record.name.store(name, std::memory_order_relaxed);
+    record.begin.store(begin, std::memory_order_relaxed);
+    record.end.store(end, std::memory_order_relaxed);
+    record.seq.store(head + 1, std::memory_order_release);
+
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+bool traceDumpRequested()
+{
+    return g_dumpRequested.exchange(false);
+}
+
+void dumpTrace()
+{
+    if (!g_traceEnabled) return;
+
+    std::FILE* out = std::fopen(g_tracer.file.c_str(), "w");
+    if (!out)
+    {
+        spdlog::error("Couldn't open trace file {}", g_tracer.file);
+        return;
+    }
+
+    int64_t from = g_tracer.lastNs > 0 ? traceNow() - g_tracer.lastNs : 0;
+    size_t written = 0;
+
+    std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", out);
+
+    std::lock_guard<std::mutex> lock(g_tracer.mutex);
+    bool first = true;
+    for (const auto& ring : g_tracer.rings)
+    {
+        std::fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"",
+                     first ? "" : ",\n", ring->tid);
+        writeEscaped(out, ring->name);
+        std::fputs("\"}}", out);
+        first = false;
+
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t count = std::min<uint64_t>(head, ring->size);
+        for (uint64_t i = head - count; i < head; ++i)
+        {
+            const Record& record = ring->records[i & (ring->size - 1)];
+
+            // skip records overwritten by their thread while we copy them
+            uint64_t seq = record.seq.load(std::memory_order_acquire);
+            const char* name = record.name.load(std::memory_order_relaxed);
+            int64_t begin = record.begin.load(std::memory_order_relaxed);
+            int64_t end = record.end.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq != i + 1 || record.seq.load(std::memory_order_relaxed) != seq) continue;
+
+            if (end < from) continue;
+
+            std::fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                         name, ring->tid, (begin - g_tracer.startNs) / 1000.0, (end - begin) / 1000.0);
+            ++written;
+        }
+    }
+
+    std::fputs("\n]}\n", out);
+    std::fclose(out);
+
+    spdlog::info("Trace with {} spans written to {}", written, g_tracer.file);
+}
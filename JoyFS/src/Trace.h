@@ -0,0 +1,55 @@
+#pragma once
+
+#include <boost/property_tree/ptree.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Opt-in timeline tracing. Spans are recorded into per-thread ring buffers and
+// dumped as Chrome trace-event JSON (loads in Perfetto or chrome://tracing).
+
+void initTracing(const boost::property_tree::ptree& settings);
+
+// writes recorded spans to the trace file, keeping only the last N seconds if configured
+void dumpTrace();
+
+// set by Ctrl+Break (SIGUSR1 on POSIX) when tracing is enabled, cleared by the call
+bool traceDumpRequested();
+
+// names the calling thread in the trace, with tracing on also allocates its ring buffer
+void setTraceThreadName(const char* name);
+
+extern std::atomic<bool> g_traceEnabled;
+
+inline int64_t traceNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void traceRecord(const char* name, int64_t begin, int64_t end);
+
+// records [construction, destruction) as a span, name must be a string literal
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char* name) : name_(name), enabled_(g_traceEnabled.load(std::memory_order_relaxed))
+    {
+        if (enabled_) begin_ = traceNow();
+    }
+
+    ~TraceSpan()
+    {
+        if (enabled_) traceRecord(name_, begin_, traceNow());
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name_;
+    bool enabled_;
+    int64_t begin_ = 0;
+};